@@ -0,0 +1,66 @@
+//
+//  Arduino.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  Just enough of the Arduino core to build the library on a PC for the
+//  benchmarks. Time is simulated: it only moves when a benchmark calls
+//  benchmarkAdvance(), so results don't depend on how fast the PC is.
+//  HardwareSerial is a pair of byte queues, see SimulatedWire.h.
+//
+
+#ifndef __ErrorDetection__BenchmarkArduino__
+#define __ErrorDetection__BenchmarkArduino__
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+
+
+typedef bool boolean;
+
+#define HIGH (0x1)
+#define LOW (0x0)
+#define OUTPUT (0x1)
+
+
+inline unsigned long benchmarkMicros = 0;
+
+inline void benchmarkAdvance(unsigned long us) { benchmarkMicros += us; }
+inline unsigned long micros() { return benchmarkMicros; }
+inline unsigned long millis() { return benchmarkMicros / 1000; }
+inline void delay(unsigned long ms) { benchmarkAdvance(ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { benchmarkAdvance(us); }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+
+class HardwareSerial {
+
+public:
+
+    std::deque<uint8_t> rx; // waiting to be read
+    std::deque<uint8_t> tx; // written, waiting on the wire
+
+    int available() { return (int)rx.size(); }
+    int read() {
+        if (rx.empty()) return -1;
+        uint8_t c = rx.front();
+        rx.pop_front();
+        return c;
+    }
+    size_t write(uint8_t c) { tx.push_back(c); return 1; }
+    void flush() {}
+
+};
+
+#endif /* defined(__ErrorDetection__BenchmarkArduino__) */
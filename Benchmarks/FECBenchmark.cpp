@@ -0,0 +1,137 @@
+//
+//  FECBenchmark.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  Sends frames through a SimulatedWire with random bit errors, with and
+//  without error correction, and works out the cost of each once a lost
+//  frame has to be sent again. From the repo root:
+//
+//      g++ -std=c++17 -O2 -I Benchmarks -I . -o fec_bench Benchmarks/FECBenchmark.cpp SerialPacket.cpp SerialFEC.cpp
+//      ./fec_bench
+//
+
+#include "Arduino.h"
+#include "SerialPacket.h"
+#include "SimulatedWire.h"
+
+#include <stdio.h>
+
+
+#define FRAMES (20000)
+#define PAYLOAD (32)
+
+
+class Counter: public SerialPacketDelegate {
+
+public:
+
+    uint8_t expected[PAYLOAD];
+    unsigned long good, bad, wrong;
+
+    Counter() { good = bad = wrong = 0; }
+
+    void didReceiveGoodPacket(SerialPacket *p) {
+        // a CRC-8 lets about 1 in 256 damaged frames through, count those too
+        if (p->getDataLength() == PAYLOAD && memcmp(p->buffer, expected, PAYLOAD) == 0) {
+            good++;
+        } else {
+            wrong++;
+        }
+    }
+
+    void didReceiveBadPacket(SerialPacket *p, uint8_t err) {
+        bad++;
+    }
+
+};
+
+
+typedef struct {
+    double delivered; // fraction of frames that made it on the first try
+    double bytesPerFrame; // on the wire, per try
+    unsigned long wrong;
+} Result;
+
+
+static Result run(uint8_t t, double ber, uint32_t seed) {
+    HardwareSerial a, b;
+    SimulatedWire wire(&a, &b, ber, seed);
+    SerialPacket sender, receiver;
+    Counter counter;
+    sender.sendUsing(&a);
+    receiver.receiveUsing(&b);
+    receiver.setDelegate(&counter);
+    sender.setErrorCorrection(t);
+    receiver.setErrorCorrection(t);
+    receiver.startReceiving();
+
+    std::mt19937 random(seed);
+    uint8_t data[PAYLOAD];
+    for (unsigned long f = 0; f < FRAMES; f++) {
+        for (uint8_t i = 0; i < PAYLOAD; i++) data[i] = (uint8_t)random();
+        memcpy(counter.expected, data, PAYLOAD);
+        sender.send(data, PAYLOAD);
+        wire.carry();
+        receiver.loop();
+    }
+
+    Result r;
+    r.delivered = (double)counter.good / FRAMES;
+    r.bytesPerFrame = (double)wire.getByteCount() / FRAMES;
+    r.wrong = counter.wrong;
+    return r;
+}
+
+
+/*
+ *  Sending again until a frame gets through costs bytesPerFrame / delivered
+ *  on average, so efficiency is the payload's share of that
+ */
+static double efficiency(Result r) {
+    if (r.delivered <= 0) return 0;
+    return PAYLOAD * r.delivered / r.bytesPerFrame;
+}
+
+
+int main() {
+    const uint8_t strengths[] = { 0, 1, 2, 4, 8 };
+    const uint8_t strengthCount = sizeof(strengths) / sizeof(strengths[0]);
+    const double rates[] = { 1e-6, 1e-5, 3e-5, 1e-4, 3e-4, 1e-3, 3e-3, 1e-2, 3e-2 };
+    const uint8_t rateCount = sizeof(rates) / sizeof(rates[0]);
+    double crossover[strengthCount];
+    for (uint8_t s = 0; s < strengthCount; s++) crossover[s] = 0;
+
+    printf("%d frames of %d bytes per cell: delivered first try / efficiency with resends\n\n", FRAMES, PAYLOAD);
+    printf("%-8s", "BER");
+    for (uint8_t s = 0; s < strengthCount; s++) printf("        t=%d       ", strengths[s]);
+    printf("\n");
+
+    for (uint8_t r = 0; r < rateCount; r++) {
+        printf("%-8.0e", rates[r]);
+        double plain = 0;
+        for (uint8_t s = 0; s < strengthCount; s++) {
+            Result result = run(strengths[s], rates[r], 1000 + r);
+            double e = efficiency(result);
+            if (s == 0) plain = e;
+            else if (crossover[s] == 0 && e > plain) crossover[s] = rates[r];
+            printf("  %6.2f%% / %5.1f%%", 100.0 * result.delivered, 100.0 * e);
+            if (result.wrong > 0) printf("!");
+            else printf(" ");
+        }
+        printf("\n");
+    }
+
+    printf("\n! = damaged frames that got past the CRC\n\n");
+    for (uint8_t s = 1; s < strengthCount; s++) {
+        if (crossover[s] > 0) printf("t=%d beats resending from BER %.0e\n", strengths[s], crossover[s]);
+        else printf("t=%d never beats resending here\n", strengths[s]);
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+//
+//  LinkBenchmark.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  What the coroutine interface costs on the host next to plain delegates:
+//  the same ping-pong over a SimulatedWire that carries everything at once,
+//  written both ways, timed in real CPU time. Also the bare cost of
+//  suspending a task and resuming it from the event loop. From the repo root:
+//
+//      g++ -std=c++20 -O2 -I Benchmarks -I . -o link_bench Benchmarks/LinkBenchmark.cpp SerialPacket.cpp SerialFEC.cpp SerialLink.cpp
+//      ./link_bench
+//
+
+#include "Arduino.h"
+#include "SerialPacket.h"
+#include "SerialLink.h"
+#include "SimulatedWire.h"
+
+#include <chrono>
+#include <stdio.h>
+
+
+#define ROUND_TRIPS (200000UL)
+#define SWITCHES (2000000UL)
+#define PAYLOAD (8)
+#define CONVERSATIONS (32)
+
+
+static double nanosSince(std::chrono::steady_clock::time_point start, unsigned long count) {
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+    return d.count() / count;
+}
+
+
+// sends back whatever it gets
+class Echo: public SerialPacketDelegate {
+
+public:
+
+    void didReceiveGoodPacket(SerialPacket *p) { p->send(p->buffer, p->getDataLength()); }
+    void didReceiveBadPacket(SerialPacket *p, uint8_t err) {}
+
+};
+
+
+// CONVERSATIONS exchanges at once, byte 0 says which one a frame belongs to
+class Pinger: public SerialPacketDelegate {
+
+public:
+
+    unsigned long sent, received;
+    uint8_t conversations;
+
+    void ping(SerialPacket *p, uint8_t conversation) {
+        uint8_t data[PAYLOAD];
+        data[0] = conversation;
+        for (uint8_t i = 1; i < PAYLOAD; i++) data[i] = (uint8_t)sent;
+        p->send(data, PAYLOAD);
+        sent++;
+    }
+
+    void didReceiveGoodPacket(SerialPacket *p) {
+        received++;
+        if (sent < ROUND_TRIPS) ping(p, p->buffer[0]);
+    }
+
+    void didReceiveBadPacket(SerialPacket *p, uint8_t err) {}
+
+};
+
+
+static double callbacks(uint8_t conversations) {
+    HardwareSerial a, b;
+    SimulatedWire there(&a, &b), back(&b, &a);
+    SerialPacket client, server;
+    Pinger pinger;
+    Echo echo;
+    client.use(&a);
+    server.use(&b);
+    client.setDelegate(&pinger);
+    server.setDelegate(&echo);
+    client.startReceiving();
+    server.startReceiving();
+    pinger.sent = pinger.received = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint8_t c = 0; c < conversations; c++) pinger.ping(&client, c);
+    while (pinger.received < ROUND_TRIPS) {
+        there.carry();
+        server.loop();
+        back.carry();
+        client.loop();
+    }
+    return nanosSince(start, ROUND_TRIPS);
+}
+
+
+static SerialTask echoTask(SerialLink *link) {
+    for (;;) {
+        SerialReceiveResult r = co_await link->receive();
+        if (r.status != SerialLink::STATUS_OK) co_return;
+        co_await link->send(r.frame.data);
+    }
+}
+
+static SerialTask pingTask(SerialLink *link, uint8_t conversation, unsigned long rounds, unsigned long *done) {
+    uint8_t data[PAYLOAD];
+    data[0] = conversation;
+    for (unsigned long n = 0; n < rounds; n++) {
+        for (uint8_t i = 1; i < PAYLOAD; i++) data[i] = (uint8_t)n;
+        co_await link->send(data, PAYLOAD);
+        SerialReceiveResult r = co_await link->receiveIf([conversation](const SerialFrame &f) {
+            return f.data.size() > 0 && f.data[0] == conversation;
+        });
+        if (r.status != SerialLink::STATUS_OK) co_return;
+        (*done)++;
+    }
+}
+
+static double coroutines(uint8_t conversations) {
+    HardwareSerial a, b;
+    SimulatedWire there(&a, &b), back(&b, &a);
+    SerialPacket client, server;
+    client.use(&a);
+    server.use(&b);
+    SerialEventLoop loop;
+    SerialLink clientLink(&loop, &client), serverLink(&loop, &server);
+    unsigned long done = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    loop.spawn(echoTask(&serverLink));
+    for (uint8_t c = 0; c < conversations; c++) {
+        loop.spawn(pingTask(&clientLink, c, ROUND_TRIPS / conversations, &done));
+    }
+    while (done < ROUND_TRIPS) {
+        loop.poll();
+        there.carry();
+        back.carry();
+    }
+    return nanosSince(start, ROUND_TRIPS);
+}
+
+
+static SerialTask yieldTask(SerialEventLoop *loop, unsigned long *count) {
+    while (*count < SWITCHES) {
+        co_await loop->sleep(0);
+        (*count)++;
+    }
+}
+
+static double switches() {
+    SerialEventLoop loop;
+    unsigned long count = 0;
+    loop.spawn(yieldTask(&loop, &count));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (loop.poll()) {}
+    return nanosSince(start, SWITCHES);
+}
+
+
+int main() {
+    printf("%lu round trips of %d bytes, ns each (lower is better)\n\n", ROUND_TRIPS, PAYLOAD);
+    printf("conversations  callbacks  coroutines\n");
+    const uint8_t counts[] = { 1, CONVERSATIONS };
+    for (uint8_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        double cb = callbacks(counts[i]);
+        double co = coroutines(counts[i]);
+        printf("%13d  %9.0f  %10.0f\n", counts[i], cb, co);
+    }
+    printf("\nsuspend + resume through the loop: %.0f ns\n", switches());
+    return 0;
+}
@@ -0,0 +1,132 @@
+//
+//  RPCBenchmark.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  Call rate and latency of SerialRPC with 1 call out at a time (stop and
+//  wait, like the ack flag in the examples) vs several in flight. Both ends
+//  run loop() once per simulated millisecond and the wire carries a fixed
+//  number of bytes per millisecond each way. From the repo root:
+//
+//      g++ -std=c++17 -O2 -I Benchmarks -I . -o rpc_bench Benchmarks/RPCBenchmark.cpp SerialPacket.cpp SerialFEC.cpp SerialRPC.cpp
+//      ./rpc_bench
+//
+
+#include "Arduino.h"
+#include "SerialPacket.h"
+#include "SerialRPC.h"
+#include "SimulatedWire.h"
+
+#include <stdio.h>
+
+
+#define SECONDS (60)
+#define PAYLOAD (8)
+#define METHOD_ECHO (1)
+
+
+class Server: public SerialRPCDelegate {
+
+public:
+
+    void didReceiveRequest(SerialRPC *rpc, uint8_t method, uint8_t *data, uint8_t len) {
+        rpc->respond(data, len);
+    }
+
+    void didCompleteCall(SerialRPC *rpc, uint8_t id, uint8_t status, uint8_t *data, uint8_t len) {}
+
+};
+
+
+class Client: public SerialRPCDelegate {
+
+    unsigned long _sentAt[256];
+
+public:
+
+    uint8_t window;
+    unsigned long completed, timeouts, failed;
+    unsigned long totalLatency, worstLatency;
+
+    Client() { completed = timeouts = failed = totalLatency = worstLatency = 0; }
+
+    // keeps window calls out at all times
+    void fill(SerialRPC *rpc) {
+        uint8_t data[PAYLOAD];
+        while (rpc->getPendingCount() < window) {
+            for (uint8_t i = 0; i < PAYLOAD; i++) data[i] = (uint8_t)(completed + i);
+            uint8_t id = rpc->call(METHOD_ECHO, data, PAYLOAD, 1000);
+            if (id == 0) {
+                failed++;
+                return;
+            }
+            _sentAt[id] = micros();
+        }
+    }
+
+    void didReceiveRequest(SerialRPC *rpc, uint8_t method, uint8_t *data, uint8_t len) {}
+
+    void didCompleteCall(SerialRPC *rpc, uint8_t id, uint8_t status, uint8_t *data, uint8_t len) {
+        if (status != SerialRPC::STATUS_OK) {
+            timeouts++;
+            return;
+        }
+        unsigned long latency = micros() - _sentAt[id];
+        completed++;
+        totalLatency += latency;
+        if (latency > worstLatency) worstLatency = latency;
+    }
+
+};
+
+
+static void run(uint8_t window, size_t bytesPerMs) {
+    HardwareSerial clientPort, serverPort;
+    SimulatedWire there(&clientPort, &serverPort), back(&serverPort, &clientPort);
+    SerialPacket clientPacket, serverPacket;
+    SerialRPC clientRPC, serverRPC;
+    Client client;
+    Server server;
+    clientPacket.use(&clientPort);
+    serverPacket.use(&serverPort);
+    clientRPC.use(&clientPacket);
+    serverRPC.use(&serverPacket);
+    clientRPC.setDelegate(&client);
+    serverRPC.setDelegate(&server);
+    client.window = window;
+
+    benchmarkMicros = 0;
+    for (unsigned long ms = 0; ms < SECONDS * 1000UL; ms++) {
+        client.fill(&clientRPC);
+        there.carry(bytesPerMs);
+        back.carry(bytesPerMs);
+        serverRPC.loop();
+        clientRPC.loop();
+        benchmarkAdvance(1000);
+    }
+
+    double mean = client.completed ? (double)client.totalLatency / client.completed / 1000.0 : 0;
+    printf("%6d  %10.1f  %9.1f  %9.1f  %8lu\n", window, (double)client.completed / SECONDS,
+           mean, client.worstLatency / 1000.0, client.timeouts);
+}
+
+
+int main() {
+    const uint8_t windows[] = { 1, 2, 4, MAX_RPC_PENDING };
+    const size_t rates[] = { 2, 7 }; // ~19200 baud, and the 7 bytes per poll the pipelining bug showed up at
+    for (uint8_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        printf("%u bytes/ms each way, %d byte payload, %d s\n", (unsigned)rates[r], PAYLOAD, SECONDS);
+        printf("in flight  calls/s  mean ms   worst ms  timeouts\n");
+        for (uint8_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+            run(windows[w], rates[r]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+//
+//  SimulatedWire.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  One direction of a serial cable for the benchmarks: moves bytes from one
+//  port's tx queue to another port's rx queue, flipping bits at a given
+//  bit error rate.
+//
+
+#ifndef __ErrorDetection__SimulatedWire__
+#define __ErrorDetection__SimulatedWire__
+
+
+#include "Arduino.h"
+
+#include <random>
+
+
+class SimulatedWire {
+
+    HardwareSerial *_from, *_to;
+    double _ber;
+    std::mt19937 _random;
+    unsigned long _untilError; // clean bits left before the next flip
+    unsigned long _bytes, _flips;
+
+    void _nextError() {
+        if (_ber <= 0) {
+            _untilError = (unsigned long)-1;
+            return;
+        }
+        std::geometric_distribution<unsigned long> gap(_ber);
+        _untilError = gap(_random);
+    }
+
+public:
+
+    SimulatedWire(HardwareSerial *from, HardwareSerial *to, double ber = 0, uint32_t seed = 1) : _random(seed) {
+        _from = from;
+        _to = to;
+        _ber = ber;
+        _bytes = 0;
+        _flips = 0;
+        _nextError();
+    }
+
+    // moves up to max bytes, returns how many went across
+    size_t carry(size_t max = (size_t)-1) {
+        size_t n = 0;
+        while (n < max && !_from->tx.empty()) {
+            uint8_t c = _from->tx.front();
+            _from->tx.pop_front();
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                if (_untilError == 0) {
+                    c ^= (uint8_t)(1 << bit);
+                    _flips++;
+                    _nextError();
+                } else if (_untilError != (unsigned long)-1) {
+                    _untilError--;
+                }
+            }
+            _to->rx.push_back(c);
+            n++;
+        }
+        _bytes += n;
+        return n;
+    }
+
+    unsigned long getByteCount() { return _bytes; }
+    unsigned long getFlipCount() { return _flips; }
+
+};
+
+#endif /* defined(__ErrorDetection__SimulatedWire__) */
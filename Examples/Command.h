@@ -0,0 +1,35 @@
+//
+//  Command.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License. 
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  The message both example sketches speak. Sender and receiver include the
+//  same schema so the two ends can't drift apart.
+//
+
+
+#ifndef __ErrorDetection__Command__
+#define __ErrorDetection__Command__
+
+
+#include "Arduino.h"
+#include "SerialMessage.h"
+
+
+// packed on the wire as: type(1) device(1) command(1) value(4) serial(1-10) ack(1)
+#define COMMAND_FIELDS(F) \
+    F(uint8_t, device, U8) \
+    F(uint8_t, command, U8) \
+    F(uint32_t, value, U32) \
+    F(uint64_t, serial, VARINT) \
+    F(uint8_t, ack, U8)
+
+SERIAL_MESSAGE(Command, 1, COMMAND_FIELDS)
+
+#endif /* defined(__ErrorDetection__Command__) */
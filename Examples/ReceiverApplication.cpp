@@ -37,9 +37,14 @@ void ReceiverApplication::didReceiveGoodPacket(SerialPacket *p) {
 
     digitalWrite(LED_GOOD, HIGH);
 
-    // copy bytes for structure from packet buffer into structre memory
+    // unpack structure from packet buffer
     Command _receivedCommand;
-    memcpy(&_receivedCommand, p->buffer, p->getDataLength());
+    if (!Command_decode(&_receivedCommand, p->buffer, p->getDataLength())) {
+        Serial.println("Recv: not a Command packet.");
+        digitalWrite(LED_GOOD, LOW);
+        p->startReceiving();
+        return;
+    }
 
     Serial.print("Recv:");
     Serial.print(" Dev:"); Serial.print(_receivedCommand.device);
@@ -59,7 +64,8 @@ void ReceiverApplication::didReceiveGoodPacket(SerialPacket *p) {
         // sender wants an acknowledgment
         Serial.print("ACK " + String((uint32_t)_receivedCommand.serial, DEC) + " ");
         _receivedCommand.ack = STATUS_ACK;
-        uint8_t bytesSent = p->send((uint8_t *)&_receivedCommand, sizeof(_receivedCommand));
+        uint8_t message[MAX_DATA_SIZE];
+        uint8_t bytesSent = p->send(message, Command_encode(&_receivedCommand, message, sizeof(message)));
         if (bytesSent > 0) {
             digitalWrite(LED_GOOD, HIGH);
             Serial.println("sent.");
@@ -108,6 +114,12 @@ void ReceiverApplication::didReceiveBadPacket(SerialPacket *p, uint8_t err) {
         case SerialPacket::ERROR_TIMEOUT:
             Serial.print("Timeout");
             break;
+        case SerialPacket::ERROR_FEC:
+            Serial.print("Uncorrectable");
+            break;
+        case SerialPacket::ERROR_DROPPED:
+            Serial.print("Dropped Records");
+            break;
             
         default:
             Serial.print("Unknown");
@@ -35,9 +35,14 @@ SenderApplication::SenderApplication() {}
 void SenderApplication::didReceiveGoodPacket(SerialPacket *p) {
     p->stopReceiving();
     digitalWrite(LED_GOOD, HIGH);
-    // copy bytes for structure from packet buffer into structre memory
+    // unpack structure from packet buffer
     Command _receivedCommand;
-    memcpy(&_receivedCommand, p->buffer, p->getDataLength());
+    if (!Command_decode(&_receivedCommand, p->buffer, p->getDataLength())) {
+        Serial.println("Not a Command packet.");
+        _state = STATE_READY;
+        digitalWrite(LED_GOOD, LOW);
+        return;
+    }
     if (_receivedCommand.ack == STATUS_ACK) {
         // this packet got acknowledgement
         if (_receivedCommand.serial == _currentCommand.serial) {
@@ -83,6 +88,12 @@ void SenderApplication::didReceiveBadPacket(SerialPacket *p, uint8_t err) {
         case SerialPacket::ERROR_TIMEOUT:
             Serial.print("Timeout");
             break;
+        case SerialPacket::ERROR_FEC:
+            Serial.print("Uncorrectable");
+            break;
+        case SerialPacket::ERROR_DROPPED:
+            Serial.print("Dropped Records");
+            break;
             
         default:
             Serial.print("Unknown");
@@ -140,7 +151,8 @@ void SenderApplication::main() {
             // send a packet
             digitalWrite(LED_SEND, HIGH);
             _newPacket();
-            uint8_t bytesSent = p.send((uint8_t *)&_currentCommand, sizeof(_currentCommand));
+            uint8_t message[MAX_DATA_SIZE];
+            uint8_t bytesSent = p.send(message, Command_encode(&_currentCommand, message, sizeof(message)));
             if (bytesSent > 0) {
                 digitalWrite(LED_GOOD, HIGH);
                 Serial.print("OK: Sent " + String(bytesSent, DEC) + " bytes: ");
@@ -16,15 +16,7 @@
 
 #include "Arduino.h"
 #include "SerialPacket.h"
-
-
-typedef struct {
-    uint8_t device;
-    uint8_t command;
-    uint32_t value;
-    uint64_t serial;
-    uint8_t ack;
-} Command;
+#include "Command.h"
 
 
 class SenderApplication: public SerialPacketDelegate {
@@ -0,0 +1,197 @@
+//
+//  SerialFEC.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+
+#include "SerialFEC.h"
+
+
+// x^8 + x^4 + x^3 + x^2 + 1, the usual GF(256) polynomial for Reed-Solomon
+#define FEC_PRIMITIVE (0x1d)
+// 1/alpha, where alpha = 2
+#define FEC_ALPHA_INVERSE (0x8e)
+
+
+SerialFEC::SerialFEC() {
+    setCorrectable(0);
+}
+
+uint8_t SerialFEC::_mul(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+    while (b) {
+        if (b & 1) p ^= a;
+        b >>= 1;
+        a = (a & 0x80) ? (uint8_t)((a << 1) ^ FEC_PRIMITIVE) : (uint8_t)(a << 1);
+    }
+    return p;
+}
+
+uint8_t SerialFEC::_pow(uint8_t a, uint8_t n) {
+    uint8_t r = 1;
+    while (n) {
+        if (n & 1) r = _mul(r, a);
+        a = _mul(a, a);
+        n >>= 1;
+    }
+    return r;
+}
+
+uint8_t SerialFEC::_inv(uint8_t a) {
+    // a^255 = 1 for every non-zero a
+    return _pow(a, 254);
+}
+
+uint8_t SerialFEC::_alpha(uint8_t n) {
+    return _pow(2, n);
+}
+
+/*
+ *  Builds g(x) = (x - a^0)(x - a^1)...(x - a^(2t-1)), highest power first
+ */
+void SerialFEC::setCorrectable(uint8_t t) {
+    if (t > MAX_FEC_CORRECTABLE) t = MAX_FEC_CORRECTABLE;
+    _parityLength = t * 2;
+    for (uint8_t i = 0; i <= MAX_FEC_PARITY; i++) _generator[i] = 0;
+    _generator[0] = 1;
+    for (uint8_t j = 0; j < _parityLength; j++) {
+        uint8_t root = _alpha(j);
+        for (uint8_t i = j + 1; i > 0; i--) {
+            _generator[i] ^= _mul(_generator[i - 1], root);
+        }
+    }
+}
+
+uint8_t SerialFEC::getParityLength() {
+    return _parityLength;
+}
+
+/*
+ *  Systematic encoding: parity is the remainder of codeword * x^2t / g(x)
+ */
+void SerialFEC::encode(uint8_t head, const uint8_t *data, uint8_t len, uint8_t *parity) {
+    for (uint8_t i = 0; i < _parityLength; i++) parity[i] = 0;
+    if (_parityLength == 0) return;
+    for (int16_t i = -1; i < len; i++) {
+        uint8_t feedback = (i < 0 ? head : data[i]) ^ parity[0];
+        for (uint8_t j = 0; j < _parityLength - 1; j++) {
+            parity[j] = parity[j + 1] ^ _mul(feedback, _generator[j + 1]);
+        }
+        parity[_parityLength - 1] = _mul(feedback, _generator[_parityLength]);
+    }
+}
+
+/*
+ *  Syndromes, then Berlekamp-Massey for the error locator, Chien search for
+ *  the error positions and Forney for the error values.
+ */
+uint8_t SerialFEC::decode(uint8_t *head, uint8_t *data, uint8_t len, uint8_t *parity) {
+    if (_parityLength == 0) return 0;
+    uint16_t n = 1 + (uint16_t)len + _parityLength;
+    if (n > MAX_FEC_CODEWORD) return UNCORRECTABLE;
+
+    // codeword symbol i, highest power of x first
+    #define FEC_SYMBOL(i) (*((i) == 0 ? head : ((i) <= len ? &data[(i) - 1] : &parity[(i) - 1 - len])))
+
+    uint8_t syndromes[MAX_FEC_PARITY];
+    boolean clean = true;
+    uint8_t root = 1;
+    for (uint8_t j = 0; j < _parityLength; j++) {
+        uint8_t s = 0;
+        for (uint16_t i = 0; i < n; i++) {
+            s = _mul(s, root) ^ FEC_SYMBOL(i);
+        }
+        syndromes[j] = s;
+        if (s != 0) clean = false;
+        root = _mul(root, 2);
+    }
+    if (clean) return 0;
+
+    // Berlekamp-Massey, polynomials are lowest power first
+    uint8_t locator[MAX_FEC_PARITY + 1], previous[MAX_FEC_PARITY + 1], temp[MAX_FEC_PARITY + 1];
+    for (uint8_t i = 0; i <= MAX_FEC_PARITY; i++) locator[i] = previous[i] = 0;
+    locator[0] = previous[0] = 1;
+    uint8_t errors = 0, shift = 1, lastDiscrepancy = 1;
+    for (uint8_t r = 0; r < _parityLength; r++) {
+        uint8_t d = syndromes[r];
+        for (uint8_t i = 1; i <= errors; i++) {
+            d ^= _mul(locator[i], syndromes[r - i]);
+        }
+        if (d == 0) {
+            shift++;
+            continue;
+        }
+        uint8_t scale = _mul(d, _inv(lastDiscrepancy));
+        if (2 * errors <= r) {
+            for (uint8_t i = 0; i <= _parityLength; i++) temp[i] = locator[i];
+            for (uint8_t i = shift; i <= _parityLength; i++) {
+                locator[i] ^= _mul(scale, previous[i - shift]);
+            }
+            errors = r + 1 - errors;
+            for (uint8_t i = 0; i <= _parityLength; i++) previous[i] = temp[i];
+            lastDiscrepancy = d;
+            shift = 1;
+        } else {
+            for (uint8_t i = shift; i <= _parityLength; i++) {
+                locator[i] ^= _mul(scale, previous[i - shift]);
+            }
+            shift++;
+        }
+    }
+    if (errors * 2 > _parityLength) return UNCORRECTABLE;
+
+    // error evaluator: syndromes(x) * locator(x) mod x^2t
+    uint8_t evaluator[MAX_FEC_PARITY];
+    for (uint8_t i = 0; i < _parityLength; i++) {
+        uint8_t v = 0;
+        for (uint8_t j = 0; j <= i && j <= errors; j++) {
+            v ^= _mul(locator[j], syndromes[i - j]);
+        }
+        evaluator[i] = v;
+    }
+
+    // Chien search from the last symbol (x^0) back to the first, finding
+    // the roots of the locator. Positions are checked before touching data.
+    uint8_t positions[MAX_FEC_CORRECTABLE], magnitudes[MAX_FEC_CORRECTABLE];
+    uint8_t found = 0;
+    uint8_t x = 1, xInverse = 1;
+    for (int16_t i = n - 1; i >= 0; i--) {
+        uint8_t sum = 0, power = 1;
+        for (uint8_t k = 0; k <= errors; k++) {
+            sum ^= _mul(locator[k], power);
+            power = _mul(power, xInverse);
+        }
+        if (sum == 0) {
+            if (found >= errors) return UNCORRECTABLE;
+            // Forney: e = x * evaluator(1/x) / locator'(1/x)
+            uint8_t numerator = 0, denominator = 0;
+            power = 1;
+            for (uint8_t k = 0; k < _parityLength; k++) {
+                numerator ^= _mul(evaluator[k], power);
+                // the formal derivative only keeps odd powers
+                if ((k & 1) == 0 && k + 1 <= errors) denominator ^= _mul(locator[k + 1], power);
+                power = _mul(power, xInverse);
+            }
+            if (denominator == 0) return UNCORRECTABLE;
+            positions[found] = (uint8_t)i;
+            magnitudes[found] = _mul(_mul(x, numerator), _inv(denominator));
+            found++;
+        }
+        x = _mul(x, 2);
+        xInverse = _mul(xInverse, FEC_ALPHA_INVERSE);
+    }
+    if (found != errors) return UNCORRECTABLE;
+
+    for (uint8_t e = 0; e < found; e++) {
+        FEC_SYMBOL(positions[e]) ^= magnitudes[e];
+    }
+    #undef FEC_SYMBOL
+
+    return found;
+}
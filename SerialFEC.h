@@ -0,0 +1,56 @@
+//
+//  SerialFEC.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  Reed-Solomon forward error correction over GF(256) for SerialPacket frames.
+//  Correcting t byte errors costs 2t parity bytes per frame. Galois field math
+//  is done bit by bit instead of with log/antilog tables to save 512 bytes of RAM.
+//
+
+#ifndef __ErrorDetection__SerialFEC__
+#define __ErrorDetection__SerialFEC__
+
+
+#include "Arduino.h"
+
+
+// most byte errors per frame we can be asked to correct
+#define MAX_FEC_CORRECTABLE (8)
+#define MAX_FEC_PARITY (MAX_FEC_CORRECTABLE * 2)
+
+// a Reed-Solomon codeword over GF(256) can't be longer than this
+#define MAX_FEC_CODEWORD (255)
+
+
+class SerialFEC {
+
+    uint8_t _parityLength;
+    uint8_t _generator[MAX_FEC_PARITY + 1];
+
+    static uint8_t _mul(uint8_t a, uint8_t b);
+    static uint8_t _pow(uint8_t a, uint8_t n);
+    static uint8_t _inv(uint8_t a);
+    static uint8_t _alpha(uint8_t n);
+
+public:
+
+    static const uint8_t UNCORRECTABLE = 0xff;
+
+    SerialFEC();
+    void setCorrectable(uint8_t t); // 0 turns FEC off
+    uint8_t getParityLength();
+    // the codeword is head byte + data + parity, so the head (CRC) gets protected too
+    void encode(uint8_t head, const uint8_t *data, uint8_t len, uint8_t *parity);
+    // fixes bytes in place, returns how many or UNCORRECTABLE
+    uint8_t decode(uint8_t *head, uint8_t *data, uint8_t len, uint8_t *parity);
+
+};
+
+#endif /* defined(__ErrorDetection__SerialFEC__) */
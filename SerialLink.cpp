@@ -0,0 +1,367 @@
+//
+//  SerialLink.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+
+#include "SerialLink.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <thread>
+
+
+// how many frames nobody asked for yet we hold on to by default
+#define DEFAULT_LINK_QUEUE_LIMIT (64)
+// longest run() sleeps when there's nothing to do, in microseconds
+#define DEFAULT_IDLE_SLEEP (1000)
+
+
+SerialTask SerialTask::promise_type::get_return_object() {
+    return SerialTask(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+void SerialTask::promise_type::unhandled_exception() {
+    std::terminate();
+}
+
+/*
+ *  When a task finishes, go straight back to whoever co_awaited it, or
+ *  just stay suspended so the event loop can clean it up
+ */
+std::coroutine_handle<> SerialTask::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+    std::coroutine_handle<> c = h.promise().continuation;
+    if (c) return c;
+    return std::noop_coroutine();
+}
+
+SerialTask::SerialTask(std::coroutine_handle<promise_type> h) {
+    _handle = h;
+}
+
+SerialTask::SerialTask(SerialTask &&t) noexcept {
+    _handle = t._handle;
+    t._handle = nullptr;
+}
+
+SerialTask::~SerialTask() {
+    if (_handle) _handle.destroy();
+}
+
+std::coroutine_handle<SerialTask::promise_type> SerialTask::release() {
+    std::coroutine_handle<promise_type> h = _handle;
+    _handle = nullptr;
+    return h;
+}
+
+bool SerialTask::await_ready() {
+    return !_handle || _handle.done();
+}
+
+std::coroutine_handle<> SerialTask::await_suspend(std::coroutine_handle<> c) {
+    _handle.promise().continuation = c;
+    return _handle;
+}
+
+
+SerialEventLoop::SerialEventLoop() {
+    _stopped = false;
+    _clock = 0;
+    _lastMillis = millis();
+    _idleSleep = DEFAULT_IDLE_SLEEP;
+    _resumed = 0;
+}
+
+/*
+ *  Waiters live in the task frames, so the links forget them before the
+ *  frames go away. Child tasks are owned by their parent's frame.
+ */
+SerialEventLoop::~SerialEventLoop() {
+    for (size_t i = 0; i < _links.size(); i++) {
+        _links[i]->_waiters.clear();
+        _links[i]->_loop = NULL;
+    }
+    _links.clear();
+    _timers.clear();
+    _ready.clear();
+    for (size_t i = 0; i < _tasks.size(); i++) {
+        _tasks[i].destroy();
+    }
+    _tasks.clear();
+}
+
+void SerialEventLoop::_schedule(std::coroutine_handle<> h) {
+    _ready.push_back(h);
+}
+
+/*
+ *  millis() wraps every 49 days, the difference between two readings doesn't,
+ *  so that's what moves our clock. Taken as 32 bits since that's where
+ *  millis() wraps, even on hosts where unsigned long is 64.
+ */
+uint64_t SerialEventLoop::_now() {
+    unsigned long m = millis();
+    _clock += (uint32_t)(m - _lastMillis);
+    _lastMillis = m;
+    return _clock;
+}
+
+void SerialEventLoop::_addTimer(SerialWaiter *w, unsigned long timeout) {
+    w->timer = _timers.insert(std::make_pair(_now() + timeout, w));
+    w->hasTimer = true;
+}
+
+void SerialEventLoop::_cancelTimer(SerialWaiter *w) {
+    if (!w->hasTimer) return;
+    _timers.erase(w->timer);
+    w->hasTimer = false;
+}
+
+void SerialEventLoop::_expireTimers() {
+    uint64_t now = _now();
+    while (!_timers.empty() && _timers.begin()->first <= now) {
+        SerialWaiter *w = _timers.begin()->second;
+        _timers.erase(_timers.begin());
+        w->hasTimer = false;
+        if (w->link != NULL) w->link->_removeWaiter(w);
+        w->result.status = SerialLink::STATUS_TIMEOUT;
+        _schedule(w->handle);
+    }
+}
+
+void SerialEventLoop::_reapTasks() {
+    for (size_t i = 0; i < _tasks.size(); ) {
+        if (_tasks[i].done()) {
+            _tasks[i].destroy();
+            _tasks[i] = _tasks.back();
+            _tasks.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void SerialEventLoop::spawn(SerialTask t) {
+    std::coroutine_handle<SerialTask::promise_type> h = t.release();
+    _tasks.push_back(h);
+    _schedule(h);
+}
+
+void SerialEventLoop::SleepAwaitable::await_suspend(std::coroutine_handle<> h) {
+    waiter.handle = h;
+    waiter.link = NULL;
+    loop->_addTimer(&waiter, timeout);
+}
+
+SerialEventLoop::SleepAwaitable SerialEventLoop::sleep(unsigned long ms) {
+    SleepAwaitable s;
+    s.loop = this;
+    s.timeout = ms;
+    s.waiter.hasTimer = false;
+    return s;
+}
+
+/*
+ *  Reads whatever the links have, fires deadlines, then resumes only the
+ *  tasks that were ready when we started so one busy task can't hog the loop
+ */
+bool SerialEventLoop::poll() {
+    for (size_t i = 0; i < _links.size(); i++) {
+        _links[i]->_packet->loop();
+    }
+    _expireTimers();
+    size_t ready = _ready.size();
+    _resumed = ready;
+    while (ready-- > 0) {
+        std::coroutine_handle<> h = _ready.front();
+        _ready.pop_front();
+        h.resume();
+    }
+    _reapTasks();
+    return !_tasks.empty() && !_stopped;
+}
+
+/*
+ *  Sleeps after a pass where no task ran and none is ready, but never past
+ *  the next deadline. Bytes that come in meanwhile wait in the port.
+ */
+void SerialEventLoop::run() {
+    _stopped = false;
+    while (poll()) {
+        if (_idleSleep == 0 || _resumed > 0 || !_ready.empty()) continue;
+        uint64_t nap = _idleSleep;
+        if (!_timers.empty()) {
+            uint64_t now = _now(), deadline = _timers.begin()->first;
+            if (deadline <= now) continue;
+            if ((deadline - now) * 1000 < nap) nap = (deadline - now) * 1000;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(nap));
+    }
+}
+
+void SerialEventLoop::setIdleSleep(unsigned long us) {
+    _idleSleep = us;
+}
+
+void SerialEventLoop::stop() {
+    _stopped = true;
+}
+
+
+SerialLink::SerialLink(SerialEventLoop *loop, SerialPacket *p) {
+    _loop = loop;
+    _packet = p;
+    _queueLimit = DEFAULT_LINK_QUEUE_LIMIT;
+    _dropped = 0;
+    _errors = 0;
+    _packet->setDelegate(this);
+    _packet->startReceiving();
+    _loop->_links.push_back(this);
+}
+
+SerialLink::~SerialLink() {
+    _packet->stopReceiving();
+    _packet->setDelegate(NULL);
+    if (_loop == NULL) return;
+    // wake everybody up rather than leave them (and run()) waiting forever
+    for (std::list<SerialWaiter *>::iterator i = _waiters.begin(); i != _waiters.end(); ++i) {
+        _loop->_cancelTimer(*i);
+        (*i)->link = NULL;
+        (*i)->result.status = STATUS_CLOSED;
+        _loop->_schedule((*i)->handle);
+    }
+    _waiters.clear();
+    std::vector<SerialLink *> &links = _loop->_links;
+    links.erase(std::remove(links.begin(), links.end(), this), links.end());
+}
+
+void SerialLink::setQueueLimit(size_t frames) {
+    _queueLimit = frames;
+}
+
+unsigned long SerialLink::getDroppedCount() {
+    return _dropped;
+}
+
+unsigned long SerialLink::getErrorCount() {
+    return _errors;
+}
+
+// hands the waiter the oldest queued frame it wants, if there is one
+bool SerialLink::_take(SerialWaiter *w) {
+    for (std::deque<SerialFrame>::iterator f = _frames.begin(); f != _frames.end(); ++f) {
+        if (!w->filter || w->filter(*f)) {
+            w->result.status = STATUS_OK;
+            w->result.frame = std::move(*f);
+            _frames.erase(f);
+            return true;
+        }
+    }
+    return false;
+}
+
+void SerialLink::_removeWaiter(SerialWaiter *w) {
+    _waiters.remove(w);
+}
+
+bool SerialLink::ReceiveAwaitable::await_ready() {
+    waiter.link = link;
+    waiter.hasTimer = false;
+    return link->_take(&waiter);
+}
+
+void SerialLink::ReceiveAwaitable::await_suspend(std::coroutine_handle<> h) {
+    waiter.handle = h;
+    link->_waiters.push_back(&waiter);
+    if (timeout > 0) link->_loop->_addTimer(&waiter, timeout);
+}
+
+SerialReceiveResult SerialLink::ReceiveAwaitable::await_resume() {
+    return std::move(waiter.result);
+}
+
+SerialLink::ReceiveAwaitable SerialLink::receive(unsigned long timeout) {
+    return receiveIf(SerialFrameFilter(), timeout);
+}
+
+/*
+ *  Only takes frames the filter accepts, so lots of conversations can share
+ *  one link, each waiting on its own frames
+ */
+SerialLink::ReceiveAwaitable SerialLink::receiveIf(SerialFrameFilter filter, unsigned long timeout) {
+    ReceiveAwaitable r;
+    r.link = this;
+    r.timeout = timeout;
+    r.waiter.filter = filter;
+    r.waiter.hasTimer = false;
+    return r;
+}
+
+SerialLink::SendAwaitable SerialLink::send(const uint8_t *p, uint8_t l) {
+    SendAwaitable s;
+    s.bytesSent = _packet->send(const_cast<uint8_t *>(p), l);
+    return s;
+}
+
+SerialLink::SendAwaitable SerialLink::send(const std::vector<uint8_t> &data) {
+    uint8_t l = data.size() > MAX_DATA_SIZE ? MAX_DATA_SIZE : (uint8_t)data.size();
+    return send(data.data(), l);
+}
+
+SerialLink::SendAwaitable SerialLink::sendTo(uint8_t a, const uint8_t *p, uint8_t l) {
+    SendAwaitable s;
+    s.bytesSent = _packet->sendTo(a, const_cast<uint8_t *>(p), l);
+    return s;
+}
+
+/*
+ *  Packet Delegate Method: Called when a valid packet is received
+ */
+void SerialLink::didReceiveGoodPacket(SerialPacket *p) {
+    SerialFrame frame;
+    frame.source = p->getSourceAddress();
+    frame.destination = p->getDestinationAddress();
+    frame.data.assign(p->buffer, p->buffer + p->getDataLength());
+    // first waiter that wants it gets it, resumed from the loop rather than
+    // from inside the decoder
+    for (std::list<SerialWaiter *>::iterator i = _waiters.begin(); i != _waiters.end(); ++i) {
+        SerialWaiter *w = *i;
+        if (!w->filter || w->filter(frame)) {
+            _waiters.erase(i);
+            _loop->_cancelTimer(w);
+            w->result.status = STATUS_OK;
+            w->result.frame = std::move(frame);
+            _loop->_schedule(w->handle);
+            return;
+        }
+    }
+    _frames.push_back(std::move(frame));
+    if (_frames.size() > _queueLimit) {
+        _frames.pop_front();
+        _dropped++;
+    }
+}
+
+/*
+ *  Packet Delegate Method: Called when an error is encountered
+ */
+void SerialLink::didReceiveBadPacket(SerialPacket *p, uint8_t err) {
+    if (err == SerialPacket::ERROR_TIMEOUT) {
+        // quiet line, receivers have their own deadlines
+        p->stopReceiving();
+        p->startReceiving();
+        return;
+    }
+    _errors++;
+}
+
+#endif /* defined(__cpp_impl_coroutine) */
@@ -0,0 +1,216 @@
+//
+//  SerialLink.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  C++20 coroutine interface for host builds (gateways, test rigs). Instead of
+//  a delegate and a hand-written state machine, protocol code is written as
+//
+//      SerialTask talk(SerialLink &link) {
+//          co_await link.send(request, len);
+//          SerialReceiveResult r = co_await link.receive(2000);
+//          if (r.status == SerialLink::STATUS_TIMEOUT) { ... }
+//      }
+//
+//  and many of those run on one SerialEventLoop thread, which polls the
+//  non-blocking SerialPacket decoder and resumes whoever is waiting.
+//  Compiles to nothing without coroutine support (AVR, pre-C++20).
+//
+
+#ifndef __ErrorDetection__SerialLink__
+#define __ErrorDetection__SerialLink__
+
+#if defined(__cpp_impl_coroutine)
+
+#include "Arduino.h"
+#include "SerialPacket.h"
+
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+
+class SerialLink;
+class SerialEventLoop;
+
+
+typedef struct {
+    uint8_t source;
+    uint8_t destination;
+    std::vector<uint8_t> data;
+} SerialFrame;
+
+
+typedef struct {
+    uint8_t status;
+    SerialFrame frame;
+} SerialReceiveResult;
+
+
+typedef std::function<bool(const SerialFrame &)> SerialFrameFilter;
+
+
+/*
+ *  Coroutine return type. Either hand it to SerialEventLoop::spawn() or
+ *  co_await it from another task.
+ */
+class SerialTask {
+
+public:
+
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+            void await_resume() noexcept {}
+        };
+
+        SerialTask get_return_object();
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+    };
+
+    SerialTask(SerialTask &&t) noexcept;
+    SerialTask(const SerialTask &) = delete;
+    ~SerialTask();
+    std::coroutine_handle<promise_type> release();
+
+    bool await_ready();
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> c);
+    void await_resume() {}
+
+private:
+
+    std::coroutine_handle<promise_type> _handle;
+
+    explicit SerialTask(std::coroutine_handle<promise_type> h);
+
+};
+
+
+// something suspended until a frame shows up or its deadline passes
+struct SerialWaiter {
+    std::coroutine_handle<> handle;
+    SerialLink *link;
+    SerialFrameFilter filter;
+    SerialReceiveResult result;
+    bool hasTimer;
+    std::multimap<uint64_t, SerialWaiter *>::iterator timer;
+};
+
+
+class SerialEventLoop {
+
+    std::vector<std::coroutine_handle<SerialTask::promise_type> > _tasks;
+    std::deque<std::coroutine_handle<> > _ready;
+    // deadlines on our own 64 bit clock, so they still sort after millis() wraps
+    std::multimap<uint64_t, SerialWaiter *> _timers;
+    uint64_t _clock;
+    unsigned long _lastMillis;
+    std::vector<SerialLink *> _links;
+    bool _stopped;
+    unsigned long _idleSleep;
+    size_t _resumed;
+
+    friend class SerialLink;
+    uint64_t _now();
+    void _schedule(std::coroutine_handle<> h);
+    void _addTimer(SerialWaiter *w, unsigned long timeout);
+    void _cancelTimer(SerialWaiter *w);
+    void _expireTimers();
+    void _reapTasks();
+
+public:
+
+    struct SleepAwaitable {
+        SerialEventLoop *loop;
+        unsigned long timeout;
+        SerialWaiter waiter;
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() {}
+    };
+
+    SerialEventLoop();
+    ~SerialEventLoop(); // tasks still suspended get destroyed
+    void spawn(SerialTask t);
+    SleepAwaitable sleep(unsigned long ms);
+    bool poll(); // one pass over links, timers and ready tasks, false when all tasks are done
+    void run(); // until every task finishes or stop(), napping when nobody has anything to do
+    void setIdleSleep(unsigned long us); // longest nap in run(), default 1000, 0 = never sleep
+    void stop();
+
+};
+
+
+class SerialLink: public SerialPacketDelegate {
+
+    SerialEventLoop *_loop;
+    SerialPacket *_packet;
+    std::deque<SerialFrame> _frames;
+    std::list<SerialWaiter *> _waiters;
+    size_t _queueLimit;
+    unsigned long _dropped, _errors;
+
+    friend class SerialEventLoop;
+    bool _take(SerialWaiter *w);
+    void _removeWaiter(SerialWaiter *w);
+
+public:
+
+    static const uint8_t STATUS_OK = 0;
+    static const uint8_t STATUS_TIMEOUT = 1;
+    static const uint8_t STATUS_CLOSED = 2; // the link went away while waiting
+
+    struct ReceiveAwaitable {
+        SerialLink *link;
+        unsigned long timeout;
+        SerialWaiter waiter;
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> h);
+        SerialReceiveResult await_resume();
+    };
+
+    // the frame is on its way to the UART by the time this resumes
+    struct SendAwaitable {
+        uint8_t bytesSent;
+        bool await_ready() { return true; }
+        void await_suspend(std::coroutine_handle<>) {}
+        uint8_t await_resume() { return bytesSent; }
+    };
+
+    SerialLink(SerialEventLoop *loop, SerialPacket *p); // takes over as p's delegate
+    ~SerialLink(); // stops p receiving, tasks still waiting on this link resume with STATUS_CLOSED
+    void setQueueLimit(size_t frames); // unclaimed frames kept before the oldest get dropped
+    unsigned long getDroppedCount();
+    unsigned long getErrorCount();
+
+    ReceiveAwaitable receive(unsigned long timeout = 0); // 0 = wait forever
+    ReceiveAwaitable receiveIf(SerialFrameFilter filter, unsigned long timeout = 0);
+    SendAwaitable send(const uint8_t *p, uint8_t l);
+    SendAwaitable send(const std::vector<uint8_t> &data);
+    SendAwaitable sendTo(uint8_t a, const uint8_t *p, uint8_t l);
+
+    // packet delegate members
+    void didReceiveGoodPacket(SerialPacket *p);
+    void didReceiveBadPacket(SerialPacket *p, uint8_t err);
+
+};
+
+#endif /* defined(__cpp_impl_coroutine) */
+
+#endif /* defined(__ErrorDetection__SerialLink__) */
@@ -0,0 +1,123 @@
+//
+//  SerialMessage.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+
+#include "SerialMessage.h"
+
+
+SerialMessageWriter::SerialMessageWriter(uint8_t *buffer, uint8_t size) {
+    _buffer = buffer;
+    _size = size;
+    _pos = 0;
+    _overflow = false;
+}
+
+void SerialMessageWriter::putU8(uint8_t v) {
+    if (_pos >= _size) {
+        _overflow = true;
+        return;
+    }
+    _buffer[_pos++] = v;
+}
+
+/*
+ *  Multi-byte fields always go out least significant byte first,
+ *  no matter what the host's byte order is
+ */
+void SerialMessageWriter::putU16(uint16_t v) {
+    putU8((uint8_t)v);
+    putU8((uint8_t)(v >> 8));
+}
+
+void SerialMessageWriter::putU32(uint32_t v) {
+    putU16((uint16_t)v);
+    putU16((uint16_t)(v >> 16));
+}
+
+void SerialMessageWriter::putU64(uint64_t v) {
+    putU32((uint32_t)v);
+    putU32((uint32_t)(v >> 32));
+}
+
+/*
+ *  7 bits per byte, low bits first, high bit set on all but the last byte
+ */
+void SerialMessageWriter::putVARINT(uint64_t v) {
+    while (v >= 0x80) {
+        putU8((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    putU8((uint8_t)v);
+}
+
+boolean SerialMessageWriter::didOverflow() {
+    return _overflow;
+}
+
+uint8_t SerialMessageWriter::getLength() {
+    return _overflow ? 0 : _pos;
+}
+
+
+SerialMessageReader::SerialMessageReader(const uint8_t *buffer, uint8_t length) {
+    _buffer = buffer;
+    _length = length;
+    _pos = 0;
+    _underflow = false;
+}
+
+uint8_t SerialMessageReader::getU8() {
+    if (_pos >= _length) {
+        _underflow = true;
+        return 0;
+    }
+    return _buffer[_pos++];
+}
+
+uint16_t SerialMessageReader::getU16() {
+    uint16_t v = getU8();
+    v |= (uint16_t)getU8() << 8;
+    return v;
+}
+
+uint32_t SerialMessageReader::getU32() {
+    uint32_t v = getU16();
+    v |= (uint32_t)getU16() << 16;
+    return v;
+}
+
+uint64_t SerialMessageReader::getU64() {
+    uint64_t v = getU32();
+    v |= (uint64_t)getU32() << 32;
+    return v;
+}
+
+uint64_t SerialMessageReader::getVARINT() {
+    uint64_t v = 0;
+    for (uint8_t shift = 0; shift < 64; shift += 7) {
+        uint8_t b = getU8();
+        // the 10th byte only has room for bit 63, anything more doesn't fit
+        if (shift == 63 && b > 1) break;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) return v;
+    }
+    // overflows 64 bits, this isn't a valid varint
+    _underflow = true;
+    return 0;
+}
+
+boolean SerialMessageReader::didUnderflow() {
+    return _underflow;
+}
+
+boolean SerialMessageReader::isComplete() {
+    return !_underflow && _pos == _length;
+}
@@ -0,0 +1,119 @@
+//
+//  SerialMessage.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+
+/*
+ *  Packed, little-endian message encoding so structs don't put compiler padding
+ *  on the wire and AVR and x86 ends agree on the layout.
+ *
+ *  A message schema is a list of fields, each one F(type, name, encoding) where
+ *  encoding is one of U8, U16, U32, U64 (fixed little-endian) or VARINT (LEB128):
+ *
+ *      #define COMMAND_FIELDS(F) \
+ *          F(uint8_t,  device,  U8) \
+ *          F(uint32_t, value,   U32) \
+ *          F(uint64_t, serial,  VARINT)
+ *
+ *      SERIAL_MESSAGE(Command, 1, COMMAND_FIELDS)
+ *
+ *  That generates the Command struct, the Command_TYPE constant,
+ *  Command_encode() and Command_decode(). The first byte on the wire is always
+ *  the message type ID.
+ */
+
+#ifndef __ErrorDetection__SerialMessage__
+#define __ErrorDetection__SerialMessage__
+
+
+#include "Arduino.h"
+
+
+// worst case encoded size of a VARINT field (64 bits, 7 bits per byte)
+#define MAX_VARINT_SIZE (10)
+
+
+class SerialMessageWriter {
+
+    uint8_t *_buffer;
+    uint8_t _size;
+    uint8_t _pos;
+    boolean _overflow;
+
+public:
+
+    SerialMessageWriter(uint8_t *buffer, uint8_t size);
+    void putU8(uint8_t v);
+    void putU16(uint16_t v);
+    void putU32(uint32_t v);
+    void putU64(uint64_t v);
+    void putVARINT(uint64_t v);
+    boolean didOverflow();
+    uint8_t getLength(); // 0 if the message didn't fit
+
+};
+
+
+class SerialMessageReader {
+
+    const uint8_t *_buffer;
+    uint8_t _length;
+    uint8_t _pos;
+    boolean _underflow;
+
+public:
+
+    SerialMessageReader(const uint8_t *buffer, uint8_t length);
+    uint8_t getU8();
+    uint16_t getU16();
+    uint32_t getU32();
+    uint64_t getU64();
+    uint64_t getVARINT();
+    boolean didUnderflow();
+    boolean isComplete(); // every byte consumed and none missing
+
+};
+
+
+// returns the message type ID of an encoded message, or 0 if there is none
+inline uint8_t SerialMessage_typeOf(const uint8_t *buffer, uint8_t length) {
+    return length > 0 ? buffer[0] : 0;
+}
+
+
+#define SERIAL_MESSAGE_FIELD_DECLARE(type, name, encoding) type name;
+#define SERIAL_MESSAGE_FIELD_ENCODE(type, name, encoding) w.put##encoding(m->name);
+#define SERIAL_MESSAGE_FIELD_DECODE(type, name, encoding) m->name = (type)r.get##encoding();
+
+/*
+ *  Generates the struct and packed encode/decode functions for a message.
+ *  encode returns the number of bytes written (0 if it didn't fit), ready for
+ *  SerialPacket::send(). decode takes the packet's buffer and data length and
+ *  returns false on a type ID mismatch or a short/long message.
+ */
+#define SERIAL_MESSAGE(Name, typeID, FIELDS) \
+    typedef struct { \
+        FIELDS(SERIAL_MESSAGE_FIELD_DECLARE) \
+    } Name; \
+    static const uint8_t Name##_TYPE = (typeID); \
+    inline uint8_t Name##_encode(const Name *m, uint8_t *buffer, uint8_t size) { \
+        SerialMessageWriter w(buffer, size); \
+        w.putU8(Name##_TYPE); \
+        FIELDS(SERIAL_MESSAGE_FIELD_ENCODE) \
+        return w.getLength(); \
+    } \
+    inline boolean Name##_decode(Name *m, const uint8_t *buffer, uint8_t length) { \
+        SerialMessageReader r(buffer, length); \
+        if (r.getU8() != Name##_TYPE) return false; \
+        FIELDS(SERIAL_MESSAGE_FIELD_DECODE) \
+        return r.isComplete(); \
+    }
+
+#endif /* defined(__ErrorDetection__SerialMessage__) */
@@ -40,6 +40,28 @@ SerialPacket::SerialPacket() {
     _dataPos = 0;
     _dataLength = 0;
     _crc = 0;
+    _corrected = 0;
+    _totalCorrected = 0;
+    _addressing = false;
+    _skipping = false;
+    _address = BROADCAST_ADDRESS;
+    _sendDestination = BROADCAST_ADDRESS;
+    _destination = BROADCAST_ADDRESS;
+    _source = BROADCAST_ADDRESS;
+    _transmitEnablePin = -1;
+    _transmitEnableHook = NULL;
+    _busIdle = 0;
+    _busSlot = 0;
+    _lastActivity = 0;
+    _waitingForBus = false;
+    _bufferFills = 0;
+    _coalescing = false;
+    _linger = 0;
+    _txStarted = 0;
+    _txBuffer = NULL;
+    _txSize = 0;
+    _txLength = 0;
+    _txDestination = BROADCAST_ADDRESS;
     for (uint8_t i = 0; i < MAX_DATA_SIZE; i++) buffer[i] = 0;
 }
 
@@ -64,11 +86,142 @@ void SerialPacket::setTimeout(unsigned long t) {
     _timeout = t;
 }
 
+/*
+ *  Reed-Solomon parity gets appended after the data so up to t damaged bytes
+ *  (CRC included) can be fixed before the CRC check instead of losing the
+ *  frame. Costs 2t bytes per frame. The length byte isn't covered.
+ */
+void SerialPacket::setErrorCorrection(uint8_t t) {
+    _fec.setCorrectable(t);
+}
+
+uint8_t SerialPacket::getCorrectedCount() {
+    return _corrected;
+}
+
+unsigned long SerialPacket::getTotalCorrected() {
+    return _totalCorrected;
+}
+
+/*
+ *  Multi-drop (RS-485) addressing: destination and source bytes go in the
+ *  header, and frames for other nodes are skipped without buffering or CRC work
+ */
+void SerialPacket::setAddress(uint8_t a) {
+    _address = a;
+    _addressing = true;
+}
+
+void SerialPacket::setDestination(uint8_t a) {
+    _sendDestination = a;
+}
+
+uint8_t SerialPacket::getSourceAddress() {
+    return _source;
+}
+
+uint8_t SerialPacket::getDestinationAddress() {
+    return _destination;
+}
+
+void SerialPacket::setTransmitEnablePin(int pin) {
+    _transmitEnablePin = pin;
+    if (_transmitEnablePin >= 0) {
+        pinMode(_transmitEnablePin, OUTPUT);
+        digitalWrite(_transmitEnablePin, LOW);
+    }
+}
+
+void SerialPacket::setTransmitEnableHook(SerialTransmitEnableHook hook) {
+    _transmitEnableHook = hook;
+    if (_transmitEnableHook != NULL) _transmitEnableHook(false);
+}
+
+/*
+ *  Listen before talk: the bus has to be quiet for idleMicros, plus
+ *  slotMicros for every step of our address, so nodes waiting on the same
+ *  frame to finish don't all jump on the bus at once. 0 turns it off.
+ */
+void SerialPacket::setBusTiming(unsigned long idleMicros, unsigned long slotMicros) {
+    _busIdle = idleMicros;
+    _busSlot = slotMicros;
+}
+
+/*
+ *  False if the bus never went quiet before the timeout. While waiting, the
+ *  decoder keeps eating what comes in (frames for us still get delivered),
+ *  which also keeps the RX ring from filling up and looking like a quiet bus.
+ *  If a delegate sends from inside that, the nested wait can't decode again
+ *  without piling more buffers on the stack, so it only watches available()
+ *  and treats a full RX ring as a busy bus.
+ */
+boolean SerialPacket::_waitForBus() {
+    if (_busIdle == 0 || _receivingSerial == NULL) return true;
+    unsigned long quiet = _busIdle + (_addressing ? _address : 0) * _busSlot;
+    unsigned long giveUp = millis() + _timeout;
+    boolean nested = _waitingForBus;
+    _waitingForBus = true;
+    int seen = _receivingSerial->available();
+    boolean quietBus = true;
+    for (;;) {
+        if (!nested) {
+            while (_receivingSerial->available() > 0) {
+                uint8_t c = (uint8_t)_receivingSerial->read();
+                if (_receiving) {
+                    _receiveByte(c);
+                } else {
+                    // nobody's listening, it's just noise on the bus to us
+                    _lastActivity = micros();
+                }
+            }
+        } else {
+            int available = _receivingSerial->available();
+            if (available != seen || available >= SERIAL_RX_BUFFER_SIZE - 1) {
+                seen = available;
+                _lastActivity = micros();
+            }
+        }
+        if (micros() - _lastActivity >= quiet) break;
+        if (millis() > giveUp) {
+            quietBus = false;
+            break;
+        }
+    }
+    if (!nested) _waitingForBus = false;
+    return quietBus;
+}
+
+/*
+ *  Coalescing: send() just queues each message as a length-prefixed record
+ *  and the frame goes out when it's full, when the first record has waited
+ *  linger ms, or on flush(). The receiving end hands each record to the
+ *  delegate separately, so it looks like the same sends came in one by one.
+ *  Whatever is queued in the old batch goes out first.
+ */
+void SerialPacket::setCoalescing(boolean c, uint8_t *batch, uint8_t size, unsigned long linger) {
+    flush();
+    _coalescing = c;
+    _txBuffer = batch;
+    _txSize = batch == NULL ? 0 : size;
+    _txLength = 0;
+    _linger = linger;
+}
+
+// what fits in one batch, records and all
+uint8_t SerialPacket::_batchSize() {
+    return _txSize < _maxDataLength() ? _txSize : _maxDataLength();
+}
+
+// CRC + data + parity has to fit in one Reed-Solomon codeword
+uint8_t SerialPacket::_maxDataLength() {
+    uint8_t l = MAX_FEC_CODEWORD - 1 - _fec.getParityLength();
+    return l < MAX_DATA_SIZE ? l : MAX_DATA_SIZE;
+}
+
 // CRC-8 - based on the CRC8 formulas by Dallas/Maxim
 // code released under the therms of the GNU GPL 3.0 license
 // Found at: http://www.leonardomiliani.com/en/2013/un-semplice-crc8-per-arduino/
-uint8_t SerialPacket::_crc8(const uint8_t *data, uint8_t len) {
-    uint8_t crc = 0x00;
+uint8_t SerialPacket::_crc8(const uint8_t *data, uint8_t len, uint8_t crc) {
     while (len--) {
         uint8_t extract = *data++;
         for (uint8_t tempI = 8; tempI; tempI--) {
@@ -83,6 +236,13 @@ uint8_t SerialPacket::_crc8(const uint8_t *data, uint8_t len) {
     return crc;
 }
 
+// header addresses are covered by the CRC too, so a damaged one isn't delivered
+uint8_t SerialPacket::_addressCRC(uint8_t destination, uint8_t source) {
+    if (!_addressing) return 0x00;
+    uint8_t addresses[2] = { destination, source };
+    return _crc8(addresses, 2);
+}
+
 uint8_t SerialPacket::getDataLength() {
     return _dataLength;
 }
@@ -91,29 +251,100 @@ bool SerialPacket::matchesCRC(SerialPacket *p) {
     return (_crc == p->_crc);
 }
 
+uint8_t SerialPacket::_writeEscaped(uint8_t c) {
+    uint8_t bytesSent = 0;
+    if ((c == ESCAPE) || (c == FRAME_START) || (c == FRAME_END)) {
+        _sendingSerial->write(ESCAPE); bytesSent++;
+    }
+    _sendingSerial->write(c); bytesSent++;
+    return bytesSent;
+}
+
 /*
  *  Blocks until data is sent
  */
 uint8_t SerialPacket::send(uint8_t *p, uint8_t l) {
+    return sendTo(_sendDestination, p, l);
+}
+
+/*
+ *  Same as send(), the address is ignored unless setAddress() was used
+ */
+uint8_t SerialPacket::sendTo(uint8_t a, uint8_t *p, uint8_t l) {
+    if (!_coalescing) return _sendFrame(a, p, l);
+    if (_sendingSerial == NULL) return 0;
+    if (l == 0) return 0;
+    uint8_t size = _batchSize();
+    if (size < 2) return 0;
+    // leave room for the record's length byte
+    if (l > size - 1) {
+        l = size - 1;
+    }
+    if (_txLength > 0 && (a != _txDestination || _txLength + 1 + l > size)) {
+        // couldn't make room, the queued batch stays for the next try
+        if (flush() == 0) return 0;
+    }
+    if (_txLength == 0) {
+        _txStarted = millis();
+        _txDestination = a;
+    }
+    _txBuffer[_txLength++] = l;
+    for (uint8_t b = 0; b < l; b++) _txBuffer[_txLength++] = p[b];
+    // no room for even a 1 byte record, may as well go now (if the bus is
+    // busy it's still queued and loop() or the next send will try again)
+    if (_txLength + 2 > size) {
+        flush();
+    }
+    return l;
+}
+
+/*
+ *  Returns 0 and keeps the batch if the frame couldn't go out
+ */
+uint8_t SerialPacket::flush() {
+    if (_txLength == 0) return 0;
+    uint8_t bytesSent = _sendFrame(_txDestination, _txBuffer, _txLength);
+    if (bytesSent > 0) _txLength = 0;
+    return bytesSent;
+}
+
+uint8_t SerialPacket::_sendFrame(uint8_t a, uint8_t *p, uint8_t l) {
     if (_sendingSerial == NULL) return 0;
     if (l == 0) return 0;
-    if (l > MAX_DATA_SIZE) {
-        l = MAX_DATA_SIZE;
+    if (l > _maxDataLength()) {
+        l = _maxDataLength();
     }
+    if (!_waitForBus()) return 0;
+    if (_transmitEnablePin >= 0) digitalWrite(_transmitEnablePin, HIGH);
+    if (_transmitEnableHook != NULL) _transmitEnableHook(true);
     uint8_t bytesSent = 0;
     _sendingSerial->write(FRAME_START); bytesSent++;
-    _crc = _crc8(p, l);
-    _sendingSerial->write(_crc); bytesSent++;
-    _dataLength = l;
-    _sendingSerial->write(_dataLength); bytesSent++;
-    uint8_t b = 0, dataCount = 0;
-    for (b = 0; b < l; b++) {
-        if ((p[b] == ESCAPE) || (p[b] == FRAME_START) || (p[b] == FRAME_END)) {
-            _sendingSerial->write(ESCAPE); bytesSent++; dataCount++;
+    if (_addressing) {
+        _sendingSerial->write(a); bytesSent++;
+        _sendingSerial->write(_address); bytesSent++;
+    }
+    // _crc and _dataLength belong to the decoder, which may be mid-frame
+    uint8_t crc = _crc8(p, l, _addressCRC(a, _address));
+    _sendingSerial->write(crc); bytesSent++;
+    _sendingSerial->write(l); bytesSent++;
+    for (uint8_t b = 0; b < l; b++) {
+        bytesSent += _writeEscaped(p[b]);
+    }
+    if (_fec.getParityLength() > 0) {
+        uint8_t parity[MAX_FEC_PARITY];
+        _fec.encode(crc, p, l, parity);
+        for (uint8_t b = 0; b < _fec.getParityLength(); b++) {
+            bytesSent += _writeEscaped(parity[b]);
         }
-        _sendingSerial->write(p[b]); bytesSent++; dataCount++;
     }
     _sendingSerial->write(FRAME_END); bytesSent++;
+    if (_transmitEnablePin >= 0 || _transmitEnableHook != NULL) {
+        // let the last byte get out of the UART before letting go of the bus
+        _sendingSerial->flush();
+        if (_transmitEnablePin >= 0) digitalWrite(_transmitEnablePin, LOW);
+        if (_transmitEnableHook != NULL) _transmitEnableHook(false);
+    }
+    _lastActivity = micros();
     return bytesSent;
 }
 
@@ -123,6 +354,8 @@ void SerialPacket::startReceiving() {
     _dataPos = 0;
     _dataLength = 0;
     _crc = 0;
+    _corrected = 0;
+    _bufferFills++;
     for (uint8_t i = 0; i < MAX_DATA_SIZE; i++) buffer[i] = 0;
     _receiving = true;
     _state = STATE_START_WAIT;
@@ -134,83 +367,177 @@ void SerialPacket::stopReceiving() {
 }
 
 void SerialPacket::_callDelegateError(uint8_t err) {
+    if (_delegate == NULL) return;
     _delegate->didReceiveBadPacket(this, err);
 }
 
+// data bytes go in the buffer, anything after that is FEC parity
+void SerialPacket::_storeByte(uint8_t c) {
+    if (_skipping) {
+        // not ours, just count it
+        _dataPos++;
+    } else if (_dataPos < _dataLength) {
+        buffer[_dataPos++] = c;
+    } else {
+        _parity[_dataPos++ - _dataLength] = c;
+    }
+}
+
+/*
+ *  Splits a coalesced frame back into records, one delegate call each, with
+ *  buffer and getDataLength() set to just that record. Each record is moved
+ *  down to the front of buffer, over the ones already delivered, so the
+ *  records still to come aren't touched. Every record gets delivered even if
+ *  a delegate calls stopReceiving(). If buffer gets reused while we're at it
+ *  (startReceiving(), or another frame decoded while send() waits for the
+ *  bus) the rest of the frame is gone and reported as ERROR_DROPPED.
+ */
+void SerialPacket::_deliverRecords() {
+    uint8_t total = _dataLength;
+    // check the whole frame first so a bad one doesn't get half delivered
+    uint16_t pos = 0;
+    while (pos < total) {
+        if (buffer[pos] == 0) break;
+        pos += 1 + buffer[pos];
+    }
+    if (pos != total) {
+        _callDelegateError(ERROR_LENGTH);
+        return;
+    }
+    uint8_t fills = _bufferFills;
+    pos = 0;
+    while (pos < total) {
+        if (_bufferFills != fills) {
+            _callDelegateError(ERROR_DROPPED);
+            return;
+        }
+        uint8_t l = buffer[pos];
+        memmove(buffer, &buffer[pos + 1], l);
+        pos += 1 + l;
+        _dataLength = l;
+        if (_delegate != NULL) _delegate->didReceiveGoodPacket(this);
+    }
+}
+
 void SerialPacket::loop() {
     
+    if (_txLength > 0 && millis() - _txStarted >= _linger) {
+        flush();
+    }
+    
     if (_receiving == false) return;
 
     while (_receivingSerial->available() > 0) {
-        _nextTimeout = millis() + _timeout;
+        _receiveByte((uint8_t)_receivingSerial->read());
+    }
+
+    if (millis() > _nextTimeout && _state != STATE_NONE) {
+        _callDelegateError(ERROR_TIMEOUT);
+    }
         
-        uint8_t c = (uint8_t)_receivingSerial->read();
+}
 
-        switch (_state) {
+/*
+ *  Runs one byte through the decoder. Can be re-entered from a delegate
+ *  (send() waiting for the bus), so the state always moves on before a
+ *  delegate gets called.
+ */
+void SerialPacket::_receiveByte(uint8_t c) {
+    _nextTimeout = millis() + _timeout;
+    _lastActivity = micros();
 
-            case STATE_START_WAIT:
-                if ((uint8_t)c == FRAME_START) {
-                    _state = STATE_CRC;
-                }
-                break;
-                
-            case STATE_CRC:
-                _crc = c;
-                _state = STATE_LENGTH;
-                break;
-                
-            case STATE_LENGTH:
-                _dataLength = c;
-                if (_dataLength < 1) {
-                    _callDelegateError(ERROR_LENGTH);
-                } else {
-                    _state = STATE_DATA;
-                    _dataPos = 0;
-                }
-                break;
-                
-            case STATE_DATA:
-                if (c == ESCAPE) {
-                    _state = STATE_ESCAPE;
-                } else if ((c == FRAME_END) || (c == FRAME_START)) {
-                    // this should not happen, so clear everything and inform delegate
-                    _callDelegateError(ERROR_LENGTH);
-                } else {
-                    buffer[_dataPos++] = c;
-                }
-                break;
-                
-            case STATE_ESCAPE:
-                _state = STATE_DATA; // this MUST go 1st, in case _addToBuffer() changes state
-                buffer[_dataPos++] = c;
-                break;
-                
-            case STATE_END_WAIT:
-                if (c == FRAME_END) {
-                    // check CRC and call delegate accordingly
-                    if (_crc == _crc8(buffer, _dataLength)) {
+    switch (_state) {
+
+        case STATE_START_WAIT:
+            if ((uint8_t)c == FRAME_START) {
+                _skipping = false;
+                _state = _addressing ? STATE_DESTINATION : STATE_CRC;
+            }
+            break;
+            
+        case STATE_DESTINATION:
+            // decide right away if we care about this frame at all
+            _destination = c;
+            _skipping = (c != _address) && (c != BROADCAST_ADDRESS);
+            _state = STATE_SOURCE;
+            break;
+            
+        case STATE_SOURCE:
+            _source = c;
+            _state = STATE_CRC;
+            break;
+            
+        case STATE_CRC:
+            _crc = c;
+            _state = STATE_LENGTH;
+            break;
+            
+        case STATE_LENGTH:
+            _dataLength = c;
+            if (_dataLength < 1) {
+                _state = STATE_START_WAIT;
+                if (!_skipping) _callDelegateError(ERROR_LENGTH);
+            } else if (_dataLength > _maxDataLength()) {
+                _state = STATE_START_WAIT;
+                if (!_skipping) _callDelegateError(ERROR_OVERFLOW);
+            } else {
+                _state = STATE_DATA;
+                _dataPos = 0;
+                if (!_skipping) _bufferFills++;
+            }
+            break;
+            
+        case STATE_DATA:
+            if (c == ESCAPE) {
+                _state = STATE_ESCAPE;
+            } else if (((c == FRAME_END) || (c == FRAME_START)) && _fec.getParityLength() == 0) {
+                // the frame was cut short, so start over on this byte and inform
+                // delegate (with FEC on it's most likely a damaged byte that can be fixed)
+                boolean skipped = _skipping;
+                _state = (c == FRAME_START) ? (_addressing ? STATE_DESTINATION : STATE_CRC) : STATE_START_WAIT;
+                _skipping = false;
+                if (!skipped) _callDelegateError(ERROR_LENGTH);
+            } else {
+                _storeByte(c);
+            }
+            break;
+            
+        case STATE_ESCAPE:
+            _state = STATE_DATA; // this MUST go 1st, in case _addToBuffer() changes state
+            _storeByte(c);
+            break;
+            
+        case STATE_END_WAIT:
+            _state = STATE_START_WAIT;
+            if (_skipping) {
+                // somebody else's frame, no CRC and no delegate
+                _skipping = false;
+            } else if (c == FRAME_END) {
+                // repair what we can, then check CRC and call delegate accordingly
+                _corrected = _fec.decode(&_crc, buffer, _dataLength, _parity);
+                if (_corrected == SerialFEC::UNCORRECTABLE) {
+                    _corrected = 0;
+                    _callDelegateError(ERROR_FEC);
+                } else if (_crc == _crc8(buffer, _dataLength, _addressCRC(_destination, _source))) {
+                    _totalCorrected += _corrected;
+                    if (_coalescing) {
+                        _deliverRecords();
+                    } else if (_delegate != NULL) {
                         _delegate->didReceiveGoodPacket(this);
-                    } else {
-                        _callDelegateError(ERROR_CRC);
                     }
                 } else {
-                    // this is not the byte we're looking for
-                    _callDelegateError(ERROR_FRAME);
+                    _callDelegateError(ERROR_CRC);
                 }
-                _state = STATE_START_WAIT;
-                break;
-                
-        }
+            } else {
+                // this is not the byte we're looking for
+                _callDelegateError(ERROR_FRAME);
+            }
+            break;
+            
+    }
     
-        // do we have all the bytes we're supposed to get?
-        if (_state == STATE_DATA && _dataPos >= _dataLength) {
-            _state = STATE_END_WAIT;
-        }
-
-    } // while ((_state != STATE_NONE) && (_receivingSerial->available() > 0))
-
-    if (millis() > _nextTimeout && _state != STATE_NONE) {
-        _callDelegateError(ERROR_TIMEOUT);
+    // do we have all the bytes we're supposed to get?
+    if (_state == STATE_DATA && _dataPos >= _dataLength + _fec.getParityLength()) {
+        _state = STATE_END_WAIT;
     }
-        
 }
@@ -15,11 +15,17 @@
 
 
 #include "Arduino.h"
+#include "SerialFEC.h"
 
 
 // 256 - (1B start) - (1B len) - (1B type) - (1B CRC8) - (1B stop) = 251
 #define MAX_DATA_SIZE (251)
 
+// HardwareSerial.h has this on newer cores, older ones are always 64
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE (64)
+#endif
+
 
 class SerialPacket;
 
@@ -33,6 +39,11 @@ public:
 };
 
 
+// for transmitters one pin can't drive (separate DE and /RE pins, an I/O
+// expander...): true right before a frame goes out, false once it's out
+typedef void (*SerialTransmitEnableHook)(boolean enable);
+
+
 class SerialPacket {
     
     uint8_t _state = STATE_NONE;
@@ -43,10 +54,35 @@ class SerialPacket {
     HardwareSerial *_sendingSerial, *_receivingSerial;
     boolean _receiving;
     unsigned long _timeout, _nextTimeout;
+    SerialFEC _fec;
+    uint8_t _parity[MAX_FEC_PARITY];
+    uint8_t _corrected;
+    unsigned long _totalCorrected;
+    boolean _addressing, _skipping;
+    uint8_t _address, _sendDestination, _destination, _source;
+    int _transmitEnablePin;
+    SerialTransmitEnableHook _transmitEnableHook;
+    unsigned long _busIdle, _busSlot, _lastActivity;
+    boolean _waitingForBus;
+    boolean _coalescing;
+    unsigned long _linger, _txStarted;
+    uint8_t *_txBuffer; // the caller's, so only nodes that batch pay for one
+    uint8_t _txSize, _txLength;
+    uint8_t _txDestination;
+    uint8_t _bufferFills;
     
-    uint8_t _crc8(const uint8_t *data, uint8_t len);
+    uint8_t _crc8(const uint8_t *data, uint8_t len, uint8_t crc = 0x00);
+    uint8_t _addressCRC(uint8_t destination, uint8_t source);
+    boolean _waitForBus();
+    uint8_t _sendFrame(uint8_t a, uint8_t *p, uint8_t l);
+    void _deliverRecords();
     void _init();
     void _callDelegateError(uint8_t err);
+    uint8_t _maxDataLength();
+    uint8_t _batchSize();
+    uint8_t _writeEscaped(uint8_t c);
+    void _storeByte(uint8_t c);
+    void _receiveByte(uint8_t c);
     
 public:
     
@@ -58,17 +94,23 @@ public:
     static const uint8_t STATE_ESCAPE = 5;
     static const uint8_t STATE_END_WAIT = 6;
     static const uint8_t STATE_END_FRAME = 7;
+    static const uint8_t STATE_DESTINATION = 8;
+    static const uint8_t STATE_SOURCE = 9;
     
     static const uint8_t ERROR_CRC = 1;
     static const uint8_t ERROR_FRAME = 2;
     static const uint8_t ERROR_LENGTH = 3;
     static const uint8_t ERROR_OVERFLOW = 4;
     static const uint8_t ERROR_TIMEOUT = 5;
+    static const uint8_t ERROR_FEC = 6;
+    static const uint8_t ERROR_DROPPED = 7; // rest of a coalesced frame, after buffer was reused by a restart or another frame
     
     static const uint8_t FRAME_START = (uint8_t)0b10101010;
     static const uint8_t FRAME_END = (uint8_t)0b01010101;
     static const uint8_t ESCAPE = (uint8_t)0x5c; // '\' or 92
     
+    static const uint8_t BROADCAST_ADDRESS = (uint8_t)0xff;
+    
     uint8_t buffer[MAX_DATA_SIZE];
     
     SerialPacket();
@@ -77,9 +119,24 @@ public:
     void receiveUsing(HardwareSerial *s);
     void setDelegate(SerialPacketDelegate *d);
     void setTimeout(unsigned long t);
+    void setErrorCorrection(uint8_t t); // byte errors to correct per frame, 0 = off, both ends must match
+    uint8_t getCorrectedCount(); // bytes corrected in the last packet
+    unsigned long getTotalCorrected();
+    void setAddress(uint8_t a); // turns on multi-drop addressing, both ends must use it
+    void setDestination(uint8_t a); // where send() goes, defaults to BROADCAST_ADDRESS
+    uint8_t getSourceAddress(); // who sent the last packet
+    uint8_t getDestinationAddress(); // our address or BROADCAST_ADDRESS
+    void setTransmitEnablePin(int pin); // RS-485 driver enable, -1 = none
+    void setTransmitEnableHook(SerialTransmitEnableHook hook); // NULL = none, works alongside the pin
+    void setBusTiming(unsigned long idleMicros, unsigned long slotMicros);
+    // batch small sends into batch (size bytes) as one frame, both ends must match.
+    // A node that only receives can pass NULL, 0 and send() will fail.
+    void setCoalescing(boolean c, uint8_t *batch, uint8_t size, unsigned long linger);
     uint8_t getDataLength();
     bool matchesCRC(SerialPacket *p);
     uint8_t send(uint8_t *p, uint8_t l);
+    uint8_t sendTo(uint8_t a, uint8_t *p, uint8_t l);
+    uint8_t flush(); // sends whatever is coalesced right now, 0 = not sent (still queued)
     void startReceiving();
     void stopReceiving();
     void loop();
@@ -0,0 +1,254 @@
+//
+//  SerialRPC.cpp
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+
+#include "SerialRPC.h"
+
+
+SerialRPC::SerialRPC() {
+    _packet = NULL;
+    _delegate = NULL;
+    _nextID = 1;
+    _inRequest = false;
+    _requestMethod = 0;
+    _requestID = 0;
+    _requestSource = SerialPacket::BROADCAST_ADDRESS;
+    for (uint8_t i = 0; i < MAX_RPC_PENDING; i++) {
+        _calls[i].active = false;
+#if defined(__cpp_impl_coroutine)
+        _calls[i].promise = NULL;
+#endif
+    }
+}
+
+SerialRPC::~SerialRPC() {
+#if defined(__cpp_impl_coroutine)
+    // don't leave anyone waiting on a future forever
+    for (uint8_t i = 0; i < MAX_RPC_PENDING; i++) {
+        if (_calls[i].active && _calls[i].promise != NULL) _complete(&_calls[i], STATUS_CANCELLED, NULL, 0);
+    }
+#endif
+}
+
+void SerialRPC::use(SerialPacket *p) {
+    _packet = p;
+    _packet->setDelegate(this);
+    _packet->startReceiving();
+}
+
+void SerialRPC::setDelegate(SerialRPCDelegate *d) {
+    _delegate = d;
+}
+
+/*
+ *  Correlation IDs go 1-255 and wrap, skipping any still waiting on a response
+ */
+uint8_t SerialRPC::_newID() {
+    for (uint16_t tries = 0; tries < 255; tries++) {
+        uint8_t id = _nextID++;
+        if (_nextID == 0) _nextID = 1;
+        if (_findCall(id) == NULL) return id;
+    }
+    return 0;
+}
+
+SerialRPCCall *SerialRPC::_findCall(uint8_t id) {
+    for (uint8_t i = 0; i < MAX_RPC_PENDING; i++) {
+        if (_calls[i].active && _calls[i].id == id) return &_calls[i];
+    }
+    return NULL;
+}
+
+// addressed = false goes wherever SerialPacket::send() would
+uint8_t SerialRPC::_send(boolean addressed, uint8_t destination, uint8_t kind, uint8_t method, uint8_t id, const uint8_t *data, uint8_t len) {
+    if (_packet == NULL) return 0;
+    if (len > MAX_RPC_PAYLOAD) return 0;
+    uint8_t frame[MAX_DATA_SIZE];
+    frame[0] = kind;
+    frame[1] = method;
+    frame[2] = id;
+    for (uint8_t i = 0; i < len; i++) frame[RPC_HEADER_SIZE + i] = data[i];
+    if (!addressed) return _packet->send(frame, RPC_HEADER_SIZE + len);
+    return _packet->sendTo(destination, frame, RPC_HEADER_SIZE + len);
+}
+
+/*
+ *  Sends the request and returns right away, the answer shows up later in
+ *  didCompleteCall() with the same ID. Returns 0 if all MAX_RPC_PENDING
+ *  slots are busy or the frame couldn't be sent. A timeout of 0 never
+ *  expires, the call stays pending until it's answered or cancel()ed.
+ */
+uint8_t SerialRPC::_call(boolean addressed, uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout) {
+    SerialRPCCall *call = NULL;
+    for (uint8_t i = 0; i < MAX_RPC_PENDING; i++) {
+        if (!_calls[i].active) {
+            call = &_calls[i];
+            break;
+        }
+    }
+    if (call == NULL) return 0;
+    uint8_t id = _newID();
+    if (id == 0) return 0;
+    // taken before sending: send() can land in didReceiveRequest() while it
+    // waits for the bus, and a call made from there needs a different slot
+    call->active = true;
+    call->id = id;
+    call->method = method;
+    call->expires = timeout > 0;
+    call->deadline = millis() + timeout;
+#if defined(__cpp_impl_coroutine)
+    call->promise = NULL;
+#endif
+    if (_send(addressed, a, KIND_REQUEST, method, id, data, len) == 0) {
+        call->active = false;
+        return 0;
+    }
+    return id;
+}
+
+/*
+ *  Frees the slot before anyone hears about it, so the delegate (or whoever
+ *  is waiting on the future) can make another call right away
+ */
+void SerialRPC::_complete(SerialRPCCall *call, uint8_t status, uint8_t *data, uint8_t len) {
+    call->active = false;
+#if defined(__cpp_impl_coroutine)
+    if (call->promise != NULL) {
+        std::promise<SerialRPCResult> *promise = call->promise;
+        call->promise = NULL;
+        SerialRPCResult result;
+        result.status = status;
+        if (data != NULL) result.data.assign(data, data + len);
+        promise->set_value(result);
+        delete promise;
+        return;
+    }
+#endif
+    if (status == STATUS_CANCELLED) return;
+    if (_delegate != NULL) _delegate->didCompleteCall(this, call->id, status, data, len);
+}
+
+uint8_t SerialRPC::call(uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout) {
+    return _call(false, 0, method, data, len, timeout);
+}
+
+uint8_t SerialRPC::callTo(uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout) {
+    return _call(true, a, method, data, len, timeout);
+}
+
+#if defined(__cpp_impl_coroutine)
+/*
+ *  Single threaded: keep calling loop() until the future is ready, e.g.
+ *  while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) rpc.loop();
+ */
+std::future<SerialRPCResult> SerialRPC::_callFuture(boolean addressed, uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout) {
+    std::promise<SerialRPCResult> *promise = new std::promise<SerialRPCResult>();
+    std::future<SerialRPCResult> future = promise->get_future();
+    uint8_t id = _call(addressed, a, method, data, len, timeout);
+    SerialRPCCall *call = id == 0 ? NULL : _findCall(id);
+    if (call == NULL) {
+        SerialRPCResult result;
+        result.status = STATUS_NOT_SENT;
+        promise->set_value(result);
+        delete promise;
+    } else {
+        call->promise = promise;
+    }
+    return future;
+}
+
+std::future<SerialRPCResult> SerialRPC::callFuture(uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout) {
+    return _callFuture(false, 0, method, data, len, timeout);
+}
+
+std::future<SerialRPCResult> SerialRPC::callFutureTo(uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout) {
+    return _callFuture(true, a, method, data, len, timeout);
+}
+#endif
+
+boolean SerialRPC::cancel(uint8_t id) {
+    SerialRPCCall *call = _findCall(id);
+    if (call == NULL) return false;
+    // a late response for it gets dropped since the ID isn't pending anymore
+    _complete(call, STATUS_CANCELLED, NULL, 0);
+    return true;
+}
+
+uint8_t SerialRPC::getPendingCount() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MAX_RPC_PENDING; i++) {
+        if (_calls[i].active) count++;
+    }
+    return count;
+}
+
+void SerialRPC::_reply(uint8_t kind, const uint8_t *data, uint8_t len) {
+    if (!_inRequest) return;
+    // one answer per request
+    _inRequest = false;
+    _send(true, _requestSource, kind, _requestMethod, _requestID, data, len);
+}
+
+void SerialRPC::respond(const uint8_t *data, uint8_t len) {
+    _reply(KIND_RESPONSE, data, len);
+}
+
+void SerialRPC::respondError(const uint8_t *data, uint8_t len) {
+    _reply(KIND_ERROR, data, len);
+}
+
+void SerialRPC::loop() {
+    if (_packet == NULL) return;
+    _packet->loop();
+    // expire calls that ran out of time
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < MAX_RPC_PENDING; i++) {
+        if (_calls[i].active && _calls[i].expires && (long)(now - _calls[i].deadline) >= 0) {
+            _complete(&_calls[i], STATUS_TIMEOUT, NULL, 0);
+        }
+    }
+}
+
+/*
+ *  Packet Delegate Method: Called when a valid packet is received
+ */
+void SerialRPC::didReceiveGoodPacket(SerialPacket *p) {
+    uint8_t len = p->getDataLength();
+    if (len < RPC_HEADER_SIZE) return;
+    uint8_t kind = p->buffer[0], method = p->buffer[1], id = p->buffer[2];
+    uint8_t *data = &p->buffer[RPC_HEADER_SIZE];
+    len -= RPC_HEADER_SIZE;
+
+    if (kind == KIND_REQUEST) {
+        _inRequest = true;
+        _requestMethod = method;
+        _requestID = id;
+        _requestSource = p->getSourceAddress();
+        if (_delegate != NULL) _delegate->didReceiveRequest(this, method, data, len);
+        _inRequest = false;
+    } else if (kind == KIND_RESPONSE || kind == KIND_ERROR) {
+        SerialRPCCall *call = _findCall(id);
+        if (call == NULL || call->method != method) return; // cancelled, timed out or not ours
+        _complete(call, kind == KIND_RESPONSE ? STATUS_OK : STATUS_ERROR, data, len);
+    }
+}
+
+/*
+ *  Packet Delegate Method: Called when an error is encountered
+ */
+void SerialRPC::didReceiveBadPacket(SerialPacket *p, uint8_t err) {
+    // a bad frame is just lost, its call (if any) will time out
+    if (err == SerialPacket::ERROR_TIMEOUT) {
+        // quiet line, start the receive timer over
+        p->stopReceiving();
+        p->startReceiving();
+    }
+}
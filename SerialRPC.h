@@ -0,0 +1,132 @@
+//
+//  SerialRPC.h
+//  Error-Detecting Serial Packet Communications for Arduino Microcontrollers
+//  Originally designed for use in the Office Chairiot Mark II motorized office chair
+//
+//  Created by Andy Frey on 4/13/15.
+//  Copyright (c) 2015 Andy Frey. All rights reserved.
+//
+//  This work is licensed under the Creative Commons Creative Commons Attribution-ShareAlike 4.0 International License.
+//  To view a copy of the license, visit: http://creativecommons.org/licenses/by-sa/4.0/legalcode
+//
+//  Request/response calls over a SerialPacket. Every request carries a method ID
+//  and a correlation ID, so several calls can be in flight at once and their
+//  responses can come back in any order.
+//
+//  On the wire: kind(1) method(1) id(1) payload(0-248)
+//
+
+#ifndef __ErrorDetection__SerialRPC__
+#define __ErrorDetection__SerialRPC__
+
+
+#include "Arduino.h"
+#include "SerialPacket.h"
+
+// host builds (same test as SerialLink.h) also get std::future calls
+#if defined(__cpp_impl_coroutine)
+#include <future>
+#include <vector>
+#endif
+
+
+// how many calls can be waiting on a response at once
+#define MAX_RPC_PENDING (8)
+
+// kind + method + id
+#define RPC_HEADER_SIZE (3)
+#define MAX_RPC_PAYLOAD (MAX_DATA_SIZE - RPC_HEADER_SIZE)
+
+
+class SerialRPC;
+
+
+class SerialRPCDelegate {
+
+public:
+    // call respond() or respondError() from in here, or don't for a one-way message
+    virtual void didReceiveRequest(SerialRPC *rpc, uint8_t method, uint8_t *data, uint8_t len) = 0;
+    // data is only good until this returns
+    virtual void didCompleteCall(SerialRPC *rpc, uint8_t id, uint8_t status, uint8_t *data, uint8_t len) = 0;
+
+};
+
+
+#if defined(__cpp_impl_coroutine)
+typedef struct {
+    uint8_t status;
+    std::vector<uint8_t> data;
+} SerialRPCResult;
+#endif
+
+
+typedef struct {
+    boolean active;
+    uint8_t id;
+    uint8_t method;
+    boolean expires; // false = timeout was 0, wait for the answer forever
+    unsigned long deadline;
+#if defined(__cpp_impl_coroutine)
+    std::promise<SerialRPCResult> *promise; // NULL = completes through the delegate
+#endif
+} SerialRPCCall;
+
+
+class SerialRPC: public SerialPacketDelegate {
+
+    SerialPacket *_packet;
+    SerialRPCDelegate *_delegate;
+    SerialRPCCall _calls[MAX_RPC_PENDING];
+    uint8_t _nextID;
+    // the request being handled in didReceiveRequest()
+    boolean _inRequest;
+    uint8_t _requestMethod, _requestID, _requestSource;
+
+    uint8_t _newID();
+    SerialRPCCall *_findCall(uint8_t id);
+    uint8_t _send(boolean addressed, uint8_t destination, uint8_t kind, uint8_t method, uint8_t id, const uint8_t *data, uint8_t len);
+    void _reply(uint8_t kind, const uint8_t *data, uint8_t len);
+    uint8_t _call(boolean addressed, uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout);
+    void _complete(SerialRPCCall *call, uint8_t status, uint8_t *data, uint8_t len);
+#if defined(__cpp_impl_coroutine)
+    std::future<SerialRPCResult> _callFuture(boolean addressed, uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout);
+#endif
+
+public:
+
+    static const uint8_t KIND_REQUEST = 1;
+    static const uint8_t KIND_RESPONSE = 2;
+    static const uint8_t KIND_ERROR = 3;
+
+    static const uint8_t STATUS_OK = 0;
+    static const uint8_t STATUS_TIMEOUT = 1;
+    static const uint8_t STATUS_ERROR = 2; // other end called respondError()
+    static const uint8_t STATUS_CANCELLED = 3; // futures only
+    static const uint8_t STATUS_NOT_SENT = 4; // futures only
+
+    SerialRPC();
+    ~SerialRPC();
+    void use(SerialPacket *p); // takes over as p's delegate and starts it receiving
+    void setDelegate(SerialRPCDelegate *d);
+    // returns call ID, 0 = failed. timeout is in ms, 0 = no timeout (same as SerialLink::receive())
+    uint8_t call(uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout);
+    // same thing, but to one node on a multi-drop bus
+    uint8_t callTo(uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout);
+#if defined(__cpp_impl_coroutine)
+    // completes the future instead of calling didCompleteCall(), loop() still has to run
+    std::future<SerialRPCResult> callFuture(uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout);
+    std::future<SerialRPCResult> callFutureTo(uint8_t a, uint8_t method, const uint8_t *data, uint8_t len, unsigned long timeout);
+#endif
+    boolean cancel(uint8_t id); // no didCompleteCall() for a cancelled call, a future gets STATUS_CANCELLED
+    uint8_t getPendingCount();
+    void respond(const uint8_t *data, uint8_t len);
+    void respondError(const uint8_t *data, uint8_t len);
+    void loop();
+
+    // packet delegate members
+    void didReceiveGoodPacket(SerialPacket *p);
+    void didReceiveBadPacket(SerialPacket *p, uint8_t err);
+
+};
+
+#endif /* defined(__ErrorDetection__SerialRPC__) */